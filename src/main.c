@@ -1,14 +1,22 @@
 #include <poll.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <time.h>
 #include <sodium.h>
 #include <sys/queue.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <libevdev/libevdev.h>
 #include <libevdev/libevdev-uinput.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
 
 #include "keycodes.h"
 
@@ -20,6 +28,11 @@
 #define POLL_TIMEOUT_MS 1            // timeout to check for new events
 #define DEFAULT_MAX_DELAY_MS 20      // upper bound on event delay
 #define DEFAULT_STARTUP_DELAY_MS 500 // wait before grabbing the input device
+#define CONTROL_BACKLOG 4            // pending connections on the control socket
+#define URING_ENTRIES 256            // submission queue size of the io_uring backend
+#define URING_READ_EVENTS 64         // max events per read with the io_uring backend
+#define FRAME_EVENTS 16              // initial capacity of a frame, grows as needed
+#define MAX_FRAME_EVENTS 512         // a longer frame is released without waiting for SYN_REPORT
 
 #define panic(format, ...) do { fprintf(stderr, format "\n", ## __VA_ARGS__); fflush(stderr); exit(EXIT_FAILURE); } while (0)
 
@@ -33,27 +46,54 @@
 
 static int interrupt = 0;       // flag to interrupt the main loop and exit
 static int verbose = 0;         // flag for verbose output
+static int paused = 0;          // flag to release events without a random delay
+static int use_io_uring = 0;    // flag to try the io_uring backend before poll
 
 static char rescue_key_seps[] = ", ";  // delims to strtok
 static char rescue_keys_str[BUFSIZE] = "KEY_LEFTSHIFT,KEY_RIGHTSHIFT,KEY_ESC";
 static int rescue_keys[MAX_RESCUE_KEYS];  // Codes of the rescue key combo
 static int rescue_len = 0;      // Number of rescue keys, set during initialization
+static int rescue_state[MAX_RESCUE_KEYS];  // Which rescue keys are currently held
 
 static int max_delay = DEFAULT_MAX_DELAY_MS;  // lag will never exceed this upper bound
 static int startup_timeout = DEFAULT_STARTUP_DELAY_MS;
 
+// device slots, a slot is free when its name is empty and it has no output device.
+// A removed device keeps its output device until its queued events are released.
 static int device_count = 0;
 static char named_inputs[MAX_INPUTS][BUFSIZE];
 
 static int input_fds[MAX_INPUTS];
 struct libevdev *output_devs[MAX_INPUTS];
 struct libevdev_uinput *uidevs[MAX_INPUTS];
+static int queued_events[MAX_INPUTS];  // number of buffered events per device
+static unsigned int input_gens[MAX_INPUTS];  // bumped whenever a slot's input is closed
+static int grab_pending[MAX_INPUTS];  // flag for devices added at runtime, not grabbed yet
+static int pending_fds[MAX_INPUTS];   // open fds of those devices
+static int pending_grabs = 0;
+static int frame_inputs[MAX_INPUTS];  // flag for devices scheduled by whole frames
+static struct entry *frames[MAX_INPUTS];  // frame being read from each device
+static int dropping[MAX_INPUTS];  // flag to discard events until SYN_REPORT after SYN_DROPPED
+
+static char control_path[BUFSIZE] = "";  // control socket, disabled when empty
+static int control_fd = -1;
+static int control_client_fd = -1;
+static unsigned int control_client_gen = 0;  // bumped whenever the client is closed
+static char control_buf[BUFSIZE];
+static size_t control_buf_len = 0;
+
+static long prev_release_time = 0;  // release time of the last buffered event
+static int queue_length = 0;           // number of buffered events
+static unsigned long events_buffered = 0;
+static unsigned long events_released = 0;
 
 static struct option long_options[] = {
     {"read",    1, 0, 'r'},
     {"delay",   1, 0, 'd'},
     {"start",   1, 0, 's'},
     {"keys",    1, 0, 'k'},
+    {"control", 1, 0, 'c'},
+    {"io-uring", 0, 0, 'u'},
     {"verbose", 0, 0, 'v'},
     {"help",    0, 0, 'h'},
     {0,         0, 0, 0}
@@ -61,11 +101,16 @@ static struct option long_options[] = {
 
 TAILQ_HEAD(tailhead, entry) head;
 
+// A single event, or for absolute pointing devices (touchpads, touchscreens,
+// tablets) a whole frame of events up to and including its SYN_REPORT,
+// released together.
 struct entry {
-    struct input_event iev;
     long time;
     TAILQ_ENTRY(entry) entries;
     int device_index;
+    int count;                  // number of events
+    int size;                   // capacity of iev
+    struct input_event iev[];
 };
 
 void sleep_ms(long milliseconds) {
@@ -89,7 +134,10 @@ long random_between(long lower, long upper) {
     return lower + randombytes_uniform(upper - lower + 1);
 }
 
-void set_rescue_keys(const char* rescue_keys_str) {
+// parse a csv list of key names into the rescue key combo.
+// returns the number of keys, or -1 on error with the reason in err.
+int parse_rescue_keys(const char* rescue_keys_str, int *keys, char *err, size_t errlen) {
+    int len = 0;
     char* _rescue_keys_str = malloc(strlen(rescue_keys_str) + 1);
     if(_rescue_keys_str == NULL) {
         panic("Failed to allocate memory for _rescue_keys_str");
@@ -102,16 +150,35 @@ void set_rescue_keys(const char* rescue_keys_str) {
     while (token != NULL) {
         int keycode = lookup_keycode(token);
         if (keycode < 0) {
-            panic("Invalid key name: '%s'\nSee keycodes.h for valid names", token);
-        } else if (rescue_len < MAX_RESCUE_KEYS) {
-            rescue_keys[rescue_len] = keycode;
-            rescue_len++;
+            snprintf(err, errlen, "Invalid key name: '%s'. See keycodes.h for valid names", token);
+            len = -1;
+            break;
+        } else if (len < MAX_RESCUE_KEYS) {
+            keys[len] = keycode;
+            len++;
         } else {
-            panic("Cannot set more than %d rescue keys", MAX_RESCUE_KEYS);
+            snprintf(err, errlen, "Cannot set more than %d rescue keys", MAX_RESCUE_KEYS);
+            len = -1;
+            break;
         }
         token = strtok(NULL, rescue_key_seps);
     }
     free(_rescue_keys_str);
+
+    if (len == 0) {
+        snprintf(err, errlen, "No rescue keys given");
+        len = -1;
+    }
+    return len;
+}
+
+void set_rescue_keys(const char* rescue_keys_str) {
+    char err[BUFSIZE];
+    int len = parse_rescue_keys(rescue_keys_str, rescue_keys, err, sizeof(err));
+    if (len < 0) {
+        panic("%s", err);
+    }
+    rescue_len = len;
 }
 
 int supports_event_type(int device_fd, int event_type) {
@@ -181,100 +248,711 @@ void detect_devices() {
     }
 }
 
-void init_inputs() {
+// grab the open input device fd for slot i. returns 0, or -1 with errno set.
+int grab_input(int i, int fd) {
+    int one = 1;
+
+    // set the device to nonblocking mode and grab it
+    if (ioctl(fd, FIONBIO, &one) < 0 || ioctl(fd, EVIOCGRAB, &one) < 0)
+        return -1;
+
+    input_fds[i] = fd;
+
+    // absolute axes report multitouch and pen state as frames
+    frame_inputs[i] = supports_event_type(fd, EV_ABS) ? 1 : 0;
+    return 0;
+}
+
+// open and grab the input device in slot i. returns 0, or -1 with errno set.
+int open_input(int i) {
     int fd;
+
+    if ((fd = open(named_inputs[i], O_RDONLY)) < 0)
+        return -1;
+
+    if (grab_input(i, fd) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+// whether any key or button of the device is down
+int keys_held(int fd) {
+    unsigned char keys[KEY_MAX/8 + 1];
+
+    memset(keys, 0, sizeof(keys));
+    if (ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) < 0)
+        return 0;
+
+    for (size_t j = 0; j < sizeof(keys); j++) {
+        if (keys[j])
+            return 1;
+    }
+    return 0;
+}
+
+// clone the input device in slot i to a new uinput device. returns 0 or a negative errno.
+int open_output(int i) {
+    int err = libevdev_new_from_fd(input_fds[i], &output_devs[i]);
+
+    if (err != 0)
+        return err;
+
+    err = libevdev_uinput_create_from_device(output_devs[i], LIBEVDEV_UINPUT_OPEN_MANAGED, &uidevs[i]);
+
+    if (err != 0) {
+        libevdev_free(output_devs[i]);
+        output_devs[i] = NULL;
+        uidevs[i] = NULL;
+        return err;
+    }
+
+    // uinput writes never block. A nonblocking fd lets io_uring perform them
+    // inline, in submission order, instead of in a worker thread.
     int one = 1;
+    if (ioctl(libevdev_uinput_get_fd(uidevs[i]), FIONBIO, &one) < 0)
+        err = -errno;
+    if (err != 0) {
+        libevdev_uinput_destroy(uidevs[i]);
+        libevdev_free(output_devs[i]);
+        output_devs[i] = NULL;
+        uidevs[i] = NULL;
+    }
+    return err;
+}
 
+void init_inputs() {
     for (int i = 0; i < device_count; i++) {
-        if ((fd = open(named_inputs[i], O_RDONLY)) < 0)
-            panic("Could not open: %s", named_inputs[i]);
+        if (open_input(i) < 0)
+            panic("Could not open or grab: %s: %s", named_inputs[i], strerror(errno));
+    }
+}
 
-        // set the device to nonblocking mode
-        if (ioctl(fd, FIONBIO, &one) < 0)
-            panic("Could set to nonblocking: %s", named_inputs[i]);
+void init_outputs() {
+    for (int i = 0; i < device_count; i++) {
+        if (open_output(i) != 0)
+            panic("Could not create uidev for input device: %s", named_inputs[i]);
+    }
+}
 
-        // grab the input device
-        if (ioctl(fd, EVIOCGRAB, &one) < 0)
-            panic("Could not grab: %s", named_inputs[i]);
+// ungrab and close the input side of slot i. The grab is released explicitly
+// since a poll still posted by the io_uring backend keeps the file open.
+void close_input(int i) {
+    int zero = 0;
 
-        input_fds[i] = fd;
+    if (input_fds[i] >= 0) {
+        ioctl(input_fds[i], EVIOCGRAB, &zero);
+        close(input_fds[i]);
+        input_fds[i] = -1;
+        input_gens[i]++;
+    }
+    if (grab_pending[i]) {
+        close(pending_fds[i]);
+        grab_pending[i] = 0;
+        pending_grabs--;
     }
+
+    // drop an incomplete frame
+    free(frames[i]);
+    frames[i] = NULL;
+    dropping[i] = 0;
 }
 
-void init_outputs() {
+// destroy the output side of slot i and mark the slot free
+void close_output(int i) {
+    if (uidevs[i] != NULL) {
+        libevdev_uinput_destroy(uidevs[i]);
+        uidevs[i] = NULL;
+    }
+    if (output_devs[i] != NULL) {
+        libevdev_free(output_devs[i]);
+        output_devs[i] = NULL;
+    }
+    named_inputs[i][0] = '\0';
+
+    // trim trailing free slots
+    while (device_count > 0 && named_inputs[device_count - 1][0] == '\0' && uidevs[device_count - 1] == NULL)
+        device_count--;
+}
+
+int find_device(const char *name) {
     for (int i = 0; i < device_count; i++) {
-        int err = libevdev_new_from_fd(input_fds[i], &output_devs[i]);
+        if ((input_fds[i] >= 0 || grab_pending[i]) && strcmp(named_inputs[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
 
-        if (err != 0)
-            panic("Could not create evdev for input device: %s", named_inputs[i]);
+// open a new device at runtime. It is grabbed by grab_pending_devices() once
+// no keys are down, otherwise a key held while grabbing, like the Enter that
+// sent the command, would be released only on the grabbed device and stay
+// "held down" for everyone else. returns the slot index, or -1 with errno set.
+int add_device(const char *name) {
+    int i, fd;
 
-        err = libevdev_uinput_create_from_device(output_devs[i], LIBEVDEV_UINPUT_OPEN_MANAGED, &uidevs[i]);
+    if (find_device(name) >= 0) {
+        errno = EEXIST;
+        return -1;
+    }
 
-        if (err != 0)
-            panic("Could not create uidev for input device: %s", named_inputs[i]);
+    for (i = 0; i < device_count; i++) {
+        if (named_inputs[i][0] == '\0' && uidevs[i] == NULL)
+            break;
     }
+    if (i >= MAX_INPUTS) {
+        errno = ENOSPC;
+        return -1;
+    }
+
+    if ((fd = open(name, O_RDONLY | O_NONBLOCK)) < 0)
+        return -1;
+
+    strncpy(named_inputs[i], name, BUFSIZE-1);
+    named_inputs[i][BUFSIZE-1] = '\0';
+    input_fds[i] = -1;
+    queued_events[i] = 0;
+    pending_fds[i] = fd;
+    grab_pending[i] = 1;
+    pending_grabs++;
+    if (i == device_count)
+        device_count++;
+    return i;
 }
 
-void emit_event(struct entry *e) {
-    int res, delay;
+// grab the devices added at runtime that have no keys down. Called on every
+// iteration of the main loop, a device with keys down is tried again later.
+void grab_pending_devices() {
+    struct input_event ev;
+    int fd, err;
+
+    for (int i = 0; i < device_count && pending_grabs > 0; i++) {
+        if (!grab_pending[i] || keys_held(pending_fds[i]))
+            continue;
+
+        fd = pending_fds[i];
+        grab_pending[i] = 0;
+        pending_grabs--;
+
+        // events read before the grab were already seen by everyone else
+        while (read(fd, &ev, sizeof(ev)) > 0)
+            ;
+
+        if (grab_input(i, fd) < 0) {
+            printf("Could not grab: %s: %s\n", named_inputs[i], strerror(errno));
+            close(fd);
+            close_output(i);
+            continue;
+        }
+        if ((err = open_output(i)) != 0) {
+            printf("Could not create uidev for input device: %s: %s\n", named_inputs[i], strerror(-err));
+            close_input(i);
+            close_output(i);
+            continue;
+        }
+
+        if (verbose)
+            printf("Grabbed: %s\n", named_inputs[i]);
+    }
+}
+
+// release the grab on a device. Events already buffered from it are still
+// released through its output device, which is destroyed once they are drained.
+int remove_device(const char *name) {
+    int i = find_device(name);
+
+    if (i < 0) {
+        errno = ENOENT;
+        return -1;
+    }
+
+    close_input(i);
+    if (queued_events[i] == 0)
+        close_output(i);
+    return 0;
+}
+
+void print_released(struct entry *e) {
     long now = current_time_ms();
-    delay = (int) (e->time - now);
+    int delay = (int) (e->time - now);
 
-    res = libevdev_uinput_write_event(uidevs[e->device_index], e->iev.type, e->iev.code, e->iev.value);
-    if (res != 0) {
-        panic("Failed to write event to uinput: %s", strerror(-res));
+    if (e->count > 1) {
+        printf("Released frame at time : %ld. Device: %d,  Events: %*d,  Missed target:  %*d ms \n",
+               e->time, e->device_index, 3, e->count, 5, delay);
+        return;
     }
 
-    if (verbose) {
-        printf("Released event at time : %ld. Device: %d,  Type: %*d,  "
-               "Code: %*d,  Value: %*d,  Missed target:  %*d ms \n",
-               e->time, e->device_index, 3, e->iev.type, 5, e->iev.code, 5, e->iev.value, 5, delay);
+    printf("Released event at time : %ld. Device: %d,  Type: %*d,  "
+           "Code: %*d,  Value: %*d,  Missed target:  %*d ms \n",
+           e->time, e->device_index, 3, e->iev[0].type, 5, e->iev[0].code, 5, e->iev[0].value, 5, delay);
+}
+
+void emit_event(struct entry *e) {
+    int res;
+
+    for (int i = 0; i < e->count; i++) {
+        res = libevdev_uinput_write_event(uidevs[e->device_index], e->iev[i].type, e->iev[i].code, e->iev[i].value);
+        if (res != 0) {
+            panic("Failed to write event to uinput: %s", strerror(-res));
+        }
     }
+
+    if (verbose)
+        print_released(e);
 }
 
-void main_loop() {
-    int err;
-    long prev_release_time = 0;
-    long current_time = 0;
+// account for and free an event once it has been written to uinput
+void event_released(struct entry *e) {
+    queue_length -= e->count;
+    events_released += e->count;
+
+    // a removed device is closed once its last event is out
+    queued_events[e->device_index] -= e->count;
+    if (queued_events[e->device_index] == 0 && input_fds[e->device_index] < 0)
+        close_output(e->device_index);
+
+    free(e);
+}
+
+// emit and free all events that are due at the given time
+void release_events(long current_time) {
+    struct entry *np;
+
+    while ((np = TAILQ_FIRST(&head)) && (current_time >= np->time)) {
+        emit_event(np);
+        TAILQ_REMOVE(&head, np, entries);
+        event_released(np);
+    }
+}
+
+struct entry *new_entry(int size) {
+    struct entry *e = malloc(sizeof(struct entry) + size * sizeof(struct input_event));
+    if (e == NULL) {
+        panic("Failed to allocate memory for entry");
+    }
+    e->count = 0;
+    e->size = size;
+    return e;
+}
+
+// append an event to an entry, growing it as needed. returns the entry,
+// which may have moved.
+struct entry *append_event(struct entry *e, unsigned int type, unsigned int code, int value) {
+    if (e->count == e->size) {
+        e = realloc(e, sizeof(struct entry) + 2 * e->size * sizeof(struct input_event));
+        if (e == NULL) {
+            panic("Failed to allocate memory for frame");
+        }
+        e->size *= 2;
+    }
+    memset(&e->iev[e->count], 0, sizeof(struct input_event));
+    e->iev[e->count].type = type;
+    e->iev[e->count].code = code;
+    e->iev[e->count].value = value;
+    e->count++;
+    return e;
+}
+
+int test_bit(const unsigned char *bits, unsigned int bit) {
+    return bits[bit/8] & (1 << (bit % 8));
+}
+
+// read the current key, absolute axis and multitouch slot state of device k
+// from the kernel, as a frame ending with SYN_REPORT. The input core drops
+// the values that did not change, so the uinput device only sees the
+// differences from the state it was left in.
+struct entry *sync_frame(int k) {
+    int fd = input_fds[k];
+    unsigned int code;
+    unsigned char key_bits[KEY_MAX/8 + 1];
+    unsigned char keys[KEY_MAX/8 + 1];
+    unsigned char abs_bits[ABS_MAX/8 + 1];
+    struct input_absinfo abs;
+    struct entry *e = new_entry(FRAME_EVENTS);
+
+    memset(key_bits, 0, sizeof(key_bits));
+    memset(keys, 0, sizeof(keys));
+    memset(abs_bits, 0, sizeof(abs_bits));
+    ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(key_bits)), key_bits);
+    ioctl(fd, EVIOCGKEY(sizeof(keys)), keys);
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(abs_bits)), abs_bits);
+
+    for (code = 0; code <= KEY_MAX; code++) {
+        if (test_bit(key_bits, code))
+            e = append_event(e, EV_KEY, code, test_bit(keys, code) ? 1 : 0);
+    }
+
+    for (code = 0; code < ABS_MT_SLOT; code++) {
+        if (test_bit(abs_bits, code) && ioctl(fd, EVIOCGABS(code), &abs) == 0)
+            e = append_event(e, EV_ABS, code, abs.value);
+    }
+
+    if (test_bit(abs_bits, ABS_MT_SLOT) && ioctl(fd, EVIOCGABS(ABS_MT_SLOT), &abs) == 0) {
+        int slots = abs.maximum + 1;
+        int ncodes = ABS_MT_TOOL_Y - ABS_MT_TOUCH_MAJOR + 1;
+
+        // for each multitouch code, the code followed by its value in every slot
+        __s32 *mt = calloc(ncodes * (slots + 1), sizeof(__s32));
+        if (mt == NULL) {
+            panic("Failed to allocate memory for multitouch state");
+        }
+        for (int c = 0; c < ncodes; c++) {
+            __s32 *values = mt + c * (slots + 1);
+            values[0] = ABS_MT_TOUCH_MAJOR + c;
+            if (!test_bit(abs_bits, values[0]) ||
+                ioctl(fd, EVIOCGMTSLOTS((slots + 1) * sizeof(__s32)), values) < 0)
+                values[0] = -1;
+        }
+
+        for (int slot = 0; slot < slots; slot++) {
+            e = append_event(e, EV_ABS, ABS_MT_SLOT, slot);
+            for (int c = 0; c < ncodes; c++) {
+                __s32 *values = mt + c * (slots + 1);
+                if (values[0] >= 0)
+                    e = append_event(e, EV_ABS, values[0], values[1 + slot]);
+            }
+        }
+        e = append_event(e, EV_ABS, ABS_MT_SLOT, abs.value);
+        free(mt);
+    }
+
+    return append_event(e, EV_SYN, SYN_REPORT, 0);
+}
+
+// append an event to the frame being read from device k. returns the frame
+// once it is complete, NULL otherwise. A frame is also cut at MAX_FRAME_EVENTS.
+// After SYN_DROPPED, the partial frames before and after it are discarded,
+// and the device state read from the kernel is returned as the next frame.
+struct entry *add_to_frame(int k, struct input_event *ev) {
+    struct entry *e = frames[k];
+
+    // the kernel dropped events, the frame can never be completed
+    if (ev->type == EV_SYN && ev->code == SYN_DROPPED) {
+        free(e);
+        frames[k] = NULL;
+        dropping[k] = 1;
+        return NULL;
+    }
+
+    if (dropping[k]) {
+        if (ev->type == EV_SYN && ev->code == SYN_REPORT) {
+            dropping[k] = 0;
+            return sync_frame(k);
+        }
+        return NULL;
+    }
+
+    if (e == NULL)
+        e = new_entry(FRAME_EVENTS);
+    e = append_event(e, ev->type, ev->code, ev->value);
+    frames[k] = e;
+
+    if ((ev->type == EV_SYN && ev->code == SYN_REPORT) || e->count >= MAX_FRAME_EVENTS) {
+        frames[k] = NULL;
+        return e;
+    }
+    return NULL;
+}
+
+// buffer an event read from device k with a random delay. The range of the
+// delay depends on the previous event buffered so that events are always
+// scheduled in the order they arrive (FIFO). Frames get a single delay.
+void schedule_event(int k, struct input_event *ev, long current_time) {
     long lower_bound = 0;
     long random_delay = 0;
-    struct input_event ev;
-    struct entry *n1, *np;
+    struct entry *n1;
+
+    // check for the rescue sequence.
+    if (ev->type == EV_KEY) {
+        int all = 1;
+        for (int j = 0; j < rescue_len; j++) {
+            if (rescue_keys[j] == ev->code)
+                rescue_state[j] = (ev->value == 0 ? 0 : 1);
+            all = all && rescue_state[j];
+        }
+        if (all)
+            interrupt = 1;
+    }
+
+    if (frame_inputs[k]) {
+        if ((n1 = add_to_frame(k, ev)) == NULL)
+            return;
+    } else {
+        n1 = new_entry(1);
+        n1->iev[n1->count++] = *ev;
+    }
+
+    // schedule the keyboard event to be released sometime in the future.
+    // lower bound must be bounded between time since last scheduled event and max delay
+    // preserves event order and bounds the maximum delay
+    lower_bound = min(max(prev_release_time - current_time, 0), max_delay);
+
+    // syn events are not delayed, nor is anything while paused
+    if ((n1->count == 1 && n1->iev[0].type == EV_SYN) || paused) {
+        random_delay = lower_bound;
+    } else {
+        random_delay = random_between(lower_bound, max_delay);
+    }
+
+    // Buffer the event
+    n1->time = current_time + random_delay;
+    n1->device_index = k;
+    TAILQ_INSERT_TAIL(&head, n1, entries);
+    queued_events[k] += n1->count;
+    queue_length += n1->count;
+    events_buffered += n1->count;
+
+    // Keep track of the previous scheduled release time
+    prev_release_time = n1->time;
+
+    if (verbose) {
+        if (n1->count > 1) {
+            printf("Buffered frame at time: %ld. Device: %d,  Events: %*d,  Scheduled delay: %*ld ms \n",
+                   n1->time, k, 3, n1->count, 4, random_delay);
+        } else {
+            printf("Buffered event at time: %ld. Device: %d,  Type: %*d,  "
+                   "Code: %*d,  Value: %*d,  Scheduled delay: %*ld ms \n",
+                   n1->time, k, 3, n1->iev[0].type, 5, n1->iev[0].code, 5, n1->iev[0].value,
+                   4, random_delay);
+        }
+        if (lower_bound > 0) {
+            printf("Lower bound raised to: %*ld ms\n", 4, lower_bound);
+        }
+    }
+}
+
+void control_reply(const char *format, ...) __attribute__((format(printf, 1, 2)));
+
+void control_reply(const char *format, ...) {
+    char reply[BUFSIZE * 2];
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(reply, sizeof(reply), format, args);
+    va_end(args);
+
+    if (len < 0)
+        return;
+    len = min(len, (int) sizeof(reply) - 1);
+
+    // replies are short, a client that does not keep up loses them
+    send(control_client_fd, reply, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+void close_control_client() {
+    close(control_client_fd);
+    control_client_fd = -1;
+    control_client_gen++;
+    control_buf_len = 0;
+}
+
+// execute a single line received on the control socket
+void control_command(char *line) {
+    char *cmd = strtok(line, " \t\r");
+    char *arg = strtok(NULL, "\r");
+    char err[BUFSIZE];
+    int keys[MAX_RESCUE_KEYS];
+    int len;
+
+    if (cmd == NULL)
+        return;
+
+    while (arg != NULL && (*arg == ' ' || *arg == '\t'))
+        arg++;
+
+    if (verbose)
+        printf("Control command: %s %s\n", cmd, arg ? arg : "");
+
+    if (strcmp(cmd, "delay") == 0) {
+        char *end;
+        long delay = arg ? strtol(arg, &end, 10) : -1;
+        if (arg == NULL || *end != '\0' || delay < 0 || delay > INT_MAX) {
+            control_reply("ERR Maximum delay must be >= 0\n");
+            return;
+        }
+        max_delay = (int) delay;
+        control_reply("OK delay %d\n", max_delay);
+    } else if (strcmp(cmd, "keys") == 0) {
+        if (arg == NULL || (len = parse_rescue_keys(arg, keys, err, sizeof(err))) < 0) {
+            control_reply("ERR %s\n", arg ? err : "No rescue keys given");
+            return;
+        }
+        memcpy(rescue_keys, keys, len * sizeof(int));
+        memset(rescue_state, 0, sizeof(rescue_state));
+        rescue_len = len;
+        control_reply("OK keys %s\n", arg);
+    } else if (strcmp(cmd, "pause") == 0) {
+        paused = 1;
+        control_reply("OK paused\n");
+    } else if (strcmp(cmd, "resume") == 0) {
+        paused = 0;
+        control_reply("OK resumed\n");
+    } else if (strcmp(cmd, "add") == 0) {
+        if (arg == NULL || add_device(arg) < 0) {
+            control_reply("ERR Could not add %s: %s\n", arg ? arg : "device", arg ? strerror(errno) : "no device given");
+            return;
+        }
+        control_reply("OK added %s, grabbed once no keys are down\n", arg);
+    } else if (strcmp(cmd, "remove") == 0) {
+        if (arg == NULL || remove_device(arg) < 0) {
+            control_reply("ERR Could not remove %s: %s\n", arg ? arg : "device", arg ? strerror(errno) : "no device given");
+            return;
+        }
+        control_reply("OK removed %s\n", arg);
+    } else if (strcmp(cmd, "stats") == 0) {
+        int devices = 0;
+        for (int i = 0; i < device_count; i++) {
+            if (input_fds[i] >= 0)
+                devices++;
+        }
+        control_reply("OK queue %d buffered %lu released %lu delay %d paused %d devices %d\n",
+                      queue_length, events_buffered, events_released, max_delay, paused, devices);
+    } else if (strcmp(cmd, "devices") == 0) {
+        for (int i = 0; i < device_count; i++) {
+            if (input_fds[i] >= 0)
+                control_reply("%d %s %d\n", i, named_inputs[i], queued_events[i]);
+            else if (grab_pending[i])
+                control_reply("%d %s pending\n", i, named_inputs[i]);
+        }
+        control_reply("OK\n");
+    } else {
+        control_reply("ERR Unknown command: %s\n", cmd);
+    }
+}
+
+void init_control() {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (control_path[0] == '\0')
+        return;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(control_path) >= sizeof(addr.sun_path))
+        panic("Control socket path too long: %s", control_path);
+    strcpy(addr.sun_path, control_path);
+
+    if ((control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+        panic("Could not create control socket: %s", strerror(errno));
+
+    // remove a stale socket left behind by a previous instance, but never
+    // another kind of file or the socket of an instance that is still running
+    if (lstat(control_path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode))
+            panic("Control socket path exists and is not a socket: %s", control_path);
 
-    // initialize the rescue state
-    int rescue_state[MAX_RESCUE_KEYS];
-    for (int i = 0; i < rescue_len; i++) {
-        rescue_state[i] = 0;
+        if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0)
+            panic("Could not create control socket: %s", strerror(errno));
+        if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0)
+            panic("Control socket is in use by another instance: %s", control_path);
+        close(fd);
+
+        if (unlink(control_path) < 0)
+            panic("Could not remove stale control socket: %s: %s", control_path, strerror(errno));
     }
 
-    // load input file descriptors for polling
-    struct pollfd *pfds = calloc(device_count, sizeof(struct pollfd));
-    if (pfds == NULL) {
-        panic("Failed to allocate memory for pollfd array");
+    // only root may reconfigure kloak
+    mode_t mask = umask(0077);
+    if (bind(control_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        panic("Could not bind control socket: %s: %s", control_path, strerror(errno));
+    umask(mask);
+
+    if (listen(control_fd, CONTROL_BACKLOG) < 0)
+        panic("Could not listen on control socket: %s: %s", control_path, strerror(errno));
+}
+
+void accept_control_client() {
+    int one = 1;
+    int fd = accept(control_fd, NULL, NULL);
+
+    if (fd < 0)
+        return;
+
+    if (ioctl(fd, FIONBIO, &one) < 0) {
+        close(fd);
+        return;
+    }
+
+    // one client at a time
+    if (control_client_fd >= 0) {
+        send(fd, "ERR Busy\n", 9, MSG_NOSIGNAL | MSG_DONTWAIT);
+        close(fd);
+        return;
+    }
+    control_client_fd = fd;
+    control_buf_len = 0;
+}
+
+// read from the control client and execute every complete line
+void handle_control_client() {
+    ssize_t n;
+    char *line, *nl;
+
+    n = read(control_client_fd, control_buf + control_buf_len, sizeof(control_buf) - control_buf_len - 1);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return;
+    if (n <= 0) {
+        close_control_client();
+        return;
+    }
+    control_buf_len += n;
+    control_buf[control_buf_len] = '\0';
+
+    line = control_buf;
+    while (control_client_fd >= 0 && (nl = strchr(line, '\n')) != NULL) {
+        *nl = '\0';
+        control_command(line);
+        line = nl + 1;
     }
-    for (int j = 0; j < device_count; j++) {
-        pfds[j].fd = input_fds[j];
-        pfds[j].events = POLLIN;
+
+    // keep a partial line for the next read
+    control_buf_len = strlen(line);
+    memmove(control_buf, line, control_buf_len + 1);
+
+    if (control_buf_len >= sizeof(control_buf) - 1) {
+        control_reply("ERR Line too long\n");
+        control_buf_len = 0;
     }
+}
+
+void main_loop() {
+    int err;
+    int nfds;
+    long current_time = 0;
+    struct input_event ev;
+
+    // input devices followed by the control socket and its client
+    struct pollfd pfds[MAX_INPUTS + 2];
 
     // the main loop breaks when the rescue keys are detected
     // On each iteration, wait for input from the input devices
     // If the event is a key press/release, then schedule for
-    // release in the future by generating a random delay. The
-    // range of the delay depends on the previous event generated
-    // so that events are always scheduled in the order they
-    // arrive (FIFO).
+    // release in the future by generating a random delay.
     while (!interrupt) {
         // Emit any events exceeding the current time
         current_time = current_time_ms();
-        while ((np = TAILQ_FIRST(&head)) && (current_time >= np->time)) {
-            emit_event(np);
-            TAILQ_REMOVE(&head, np, entries);
-            free(np);
+        release_events(current_time);
+        grab_pending_devices();
+
+        // load input file descriptors for polling, the device set may
+        // change between iterations. poll() ignores negative fds.
+        for (int j = 0; j < device_count; j++) {
+            pfds[j].fd = input_fds[j];
+            pfds[j].events = POLLIN;
         }
+        pfds[device_count].fd = control_fd;
+        pfds[device_count].events = POLLIN;
+        pfds[device_count + 1].fd = control_client_fd;
+        pfds[device_count + 1].events = POLLIN;
+        nfds = device_count + 2;
 
         // Wait for next input event
-        if ((err = poll(pfds, device_count, POLL_TIMEOUT_MS)) < 0)
+        if ((err = poll(pfds, nfds, POLL_TIMEOUT_MS)) < 0)
             panic("poll() failed: %s\n", strerror(errno));
 
         // timed out, do nothing
@@ -285,63 +963,277 @@ void main_loop() {
         current_time = current_time_ms();
 
         // Buffer the event with a random delay
-        for (int k = 0; k < device_count; k++) {
+        for (int k = 0; k < nfds - 2; k++) {
             if (pfds[k].revents & POLLIN) {
                 if ((err = read(pfds[k].fd, &ev, sizeof(ev))) <= 0)
                     panic("read() failed: %s", strerror(errno));
 
-                // check for the rescue sequence.
-                if (ev.type == EV_KEY) {
-                    int all = 1;
-                    for (int j = 0; j < rescue_len; j++) {
-                        if (rescue_keys[j] == ev.code)
-                            rescue_state[j] = (ev.value == 0 ? 0 : 1);
-                        all = all && rescue_state[j];
-                    }
-                    if (all)
-                        interrupt = 1;
-                }
+                schedule_event(k, &ev, current_time);
+            }
+        }
+
+        // handle control requests last, they may change the device set
+        if (pfds[nfds - 1].revents & (POLLIN | POLLHUP | POLLERR))
+            handle_control_client();
+        if (pfds[nfds - 2].revents & POLLIN)
+            accept_control_client();
+    }
+}
+
+#ifdef HAVE_LIBURING
+// The io_uring backend keeps a multishot poll posted on every grabbed device
+// and a poll on the control socket, queues due events as a linked chain of
+// uinput writes and waits for the next release deadline, all in one
+// io_uring_enter() call. evdev has no nowait reads, a read posted on a device
+// would block an io-wq worker, so a device that becomes readable is drained
+// with read() instead, up to URING_READ_EVENTS events per call.
+// Completions are told apart by an operation tag in the low bits of user_data.
+// Entries are at least 8 byte aligned, so a write carries its entry pointer.
+enum uring_op {
+    URING_READ,
+    URING_WRITE,
+    URING_CONTROL,
+    URING_CLIENT,
+    URING_CANCEL
+};
+
+#define URING_OP_BITS 3
+#define URING_OP_MASK ((1 << URING_OP_BITS) - 1)
+
+// submission queue entries kept free of writes for the reads, polls and
+// cancels queued in the same iteration
+#define URING_RESERVED (2 * MAX_INPUTS + 3)
+
+static struct io_uring ring;
+static int writes_in_flight = 0;  // writes of the current chain not yet completed
+static struct input_event uring_bufs[MAX_INPUTS][URING_READ_EVENTS];
+
+__u64 uring_data(enum uring_op op, __u64 payload) {
+    return (payload << URING_OP_BITS) | op;
+}
+
+// device polls carry the slot and the generation of its input
+__u64 uring_read_data(int i) {
+    return uring_data(URING_READ, ((__u64) input_gens[i] << 8) | i);
+}
+
+// get a submission queue entry, flushing the queue when it is full. Write
+// chains never reach this point thanks to URING_RESERVED.
+struct io_uring_sqe *uring_get_sqe() {
+    struct io_uring_sqe *sqe;
+    int err;
+
+    while ((sqe = io_uring_get_sqe(&ring)) == NULL) {
+        if ((err = io_uring_submit(&ring)) < 0)
+            panic("io_uring_submit() failed: %s", strerror(-err));
+    }
+    return sqe;
+}
+
+void uring_cancel(__u64 data) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    io_uring_prep_cancel64(sqe, data, 0);
+    io_uring_sqe_set_data64(sqe, uring_data(URING_CANCEL, 0));
+}
+
+void uring_poll(int fd, __u64 data) {
+    struct io_uring_sqe *sqe = uring_get_sqe();
+    io_uring_prep_poll_add(sqe, fd, POLLIN);
+    io_uring_sqe_set_data64(sqe, data);
+}
+
+// queue the uinput writes of the events that are due. The writes are linked
+// so they are performed in FIFO order, and only one chain is in flight so
+// chains cannot overtake each other. Entries are freed on completion.
+void uring_release_events(long current_time) {
+    struct entry *np;
+    struct io_uring_sqe *sqe = NULL;
+    unsigned int space;
+
+    if (writes_in_flight > 0)
+        return;
+
+    // the chain must fit in the submission queue, the rest waits for the next one
+    space = io_uring_sq_space_left(&ring);
+    space = space > URING_RESERVED ? space - URING_RESERVED : 0;
+
+    while (space > 0 && (np = TAILQ_FIRST(&head)) && (current_time >= np->time)) {
+        TAILQ_REMOVE(&head, np, entries);
+        space--;
+        writes_in_flight++;
+        sqe = io_uring_get_sqe(&ring);
+        io_uring_prep_write(sqe, libevdev_uinput_get_fd(uidevs[np->device_index]),
+                            np->iev, np->count * sizeof(struct input_event), 0);
+        io_uring_sqe_set_data64(sqe, (__u64) (uintptr_t) np | URING_WRITE);
+        io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+    }
+
+    // end the chain
+    if (sqe != NULL)
+        io_uring_sqe_set_flags(sqe, 0);
+}
+
+// returns a negative errno if io_uring cannot be used, before touching any device
+int uring_loop() {
+    int err;
+    int read_posted[MAX_INPUTS] = {0};     // a poll is in flight, until its last completion
+    int read_cancelled[MAX_INPUTS] = {0};
+    int multishot = 1;                     // cleared on kernels without multishot polls
+    ssize_t n;
+    unsigned int read_gens[MAX_INPUTS];
+    int control_posted = 0;
+    int client_posted = 0;
+    unsigned int client_gen = 0;
+    unsigned int cq_head, count;
+    long current_time = 0;
+    long timeout;
+    struct entry *np;
+    struct io_uring_cqe *cqe;
+    struct __kernel_timespec ts;
 
-                // schedule the keyboard event to be released sometime in the future.
-                // lower bound must be bounded between time since last scheduled event and max delay
-                // preserves event order and bounds the maximum delay
-                lower_bound = min(max(prev_release_time - current_time, 0), max_delay);
+    if ((err = io_uring_queue_init(URING_ENTRIES, &ring, 0)) < 0)
+        return err;
 
-                // syn events are not delayed
-                if (ev.type == EV_SYN) {
-                    random_delay = lower_bound;
-                } else {
-                    random_delay = random_between(lower_bound, max_delay);
+    while (!interrupt) {
+        // Queue any events exceeding the current time
+        current_time = current_time_ms();
+        uring_release_events(current_time);
+        grab_pending_devices();
+
+        // keep a poll posted on every grabbed device, and cancel the polls of
+        // devices that were removed so their files are closed. A slot that is
+        // reused waits for the last completion of the cancelled poll.
+        for (int i = 0; i < MAX_INPUTS; i++) {
+            int grabbed = i < device_count && input_fds[i] >= 0;
+
+            if (read_posted[i] && !read_cancelled[i] && (!grabbed || read_gens[i] != input_gens[i])) {
+                uring_cancel(uring_data(URING_READ, ((__u64) read_gens[i] << 8) | i));
+                read_cancelled[i] = 1;
+            }
+            if (grabbed && !read_posted[i]) {
+                struct io_uring_sqe *sqe = uring_get_sqe();
+
+                if (multishot)
+                    io_uring_prep_poll_multishot(sqe, input_fds[i], POLLIN);
+                else
+                    io_uring_prep_poll_add(sqe, input_fds[i], POLLIN);
+                io_uring_sqe_set_data64(sqe, uring_read_data(i));
+                read_posted[i] = 1;
+                read_gens[i] = input_gens[i];
+            }
+        }
+
+        if (control_fd >= 0 && !control_posted) {
+            uring_poll(control_fd, uring_data(URING_CONTROL, 0));
+            control_posted = 1;
+        }
+        if (client_posted && client_gen != control_client_gen) {
+            uring_cancel(uring_data(URING_CLIENT, client_gen));
+            client_posted = 0;
+        }
+        if (control_client_fd >= 0 && !client_posted) {
+            uring_poll(control_client_fd, uring_data(URING_CLIENT, control_client_gen));
+            client_posted = 1;
+            client_gen = control_client_gen;
+        }
+
+        // Submit and wait for input, write completions or the next release
+        // deadline. While a chain is in flight its completion is waited for.
+        // Devices waiting to be grabbed are checked again after POLL_TIMEOUT_MS.
+        timeout = -1;
+        if (writes_in_flight == 0 && (np = TAILQ_FIRST(&head)) != NULL)
+            timeout = max(np->time - current_time_ms(), 0);
+        if (pending_grabs > 0)
+            timeout = timeout < 0 ? POLL_TIMEOUT_MS : min(timeout, POLL_TIMEOUT_MS);
+
+        if (timeout >= 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+            err = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, &ts, NULL);
+        } else {
+            err = io_uring_submit_and_wait_timeout(&ring, &cqe, 1, NULL, NULL);
+        }
+        if (err < 0 && err != -ETIME && err != -EINTR)
+            panic("io_uring_submit_and_wait_timeout() failed: %s", strerror(-err));
+
+        // An event may be available, mark the current time
+        current_time = current_time_ms();
+
+        count = 0;
+        io_uring_for_each_cqe(&ring, cq_head, cqe) {
+            __u64 data = io_uring_cqe_get_data64(cqe);
+            __u64 payload = data >> URING_OP_BITS;
+            int i = payload & 0xff;
+            count++;
+
+            switch (data & URING_OP_MASK) {
+            case URING_READ:
+                // the poll is over, it is posted again in the next iteration
+                if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                    read_posted[i] = 0;
+                    read_cancelled[i] = 0;
                 }
 
-                // Buffer the event
-                n1 = malloc(sizeof(struct entry));
-                if (n1 == NULL) {
-                    panic("Failed to allocate memory for entry");
+                // stale completion of a device that was removed
+                if ((payload >> 8) != input_gens[i] || input_fds[i] < 0)
+                    break;
+                if (cqe->res == -EINVAL && multishot) {
+                    multishot = 0;
+                    break;
                 }
-                n1->time = current_time + random_delay;
-                n1->iev = ev;
-                n1->device_index = k;
-                TAILQ_INSERT_TAIL(&head, n1, entries);
-
-                // Keep track of the previous scheduled release time
-                prev_release_time = n1->time;
-
-                if (verbose) {
-                    printf("Buffered event at time: %ld. Device: %d,  Type: %*d,  "
-                           "Code: %*d,  Value: %*d,  Scheduled delay: %*ld ms \n",
-                           n1->time, k, 3, n1->iev.type, 5, n1->iev.code, 5, n1->iev.value,
-                           4, random_delay);
-                    if (lower_bound > 0) {
-                        printf("Lower bound raised to: %*ld ms\n", 4, lower_bound);
+                if (cqe->res < 0)
+                    panic("poll() failed: %s", strerror(-cqe->res));
+
+                // Buffer the events with a random delay. A short read means
+                // the device is drained, new events fire the poll again.
+                do {
+                    if ((n = read(input_fds[i], uring_bufs[i], sizeof(uring_bufs[i]))) < 0) {
+                        if (errno == EAGAIN)
+                            break;
+                        panic("read() failed: %s", strerror(errno));
                     }
-                }
+                    for (int j = 0; j < n / (int) sizeof(struct input_event); j++)
+                        schedule_event(i, &uring_bufs[i][j], current_time);
+                } while (n == sizeof(uring_bufs[i]) && input_fds[i] >= 0);
+                break;
+
+            case URING_WRITE:
+                writes_in_flight--;
+                np = (struct entry *) (uintptr_t) (data & ~(__u64) URING_OP_MASK);
+                if (cqe->res < 0)
+                    panic("Failed to write event to uinput: %s", strerror(-cqe->res));
+                if (verbose)
+                    print_released(np);
+                event_released(np);
+                break;
+
+            case URING_CONTROL:
+                control_posted = 0;
+                accept_control_client();
+                break;
+
+            case URING_CLIENT:
+                if (payload != control_client_gen || control_client_fd < 0)
+                    break;
+                client_posted = 0;
+                handle_control_client();
+                break;
+
+            case URING_CANCEL:
+                break;
             }
         }
+        io_uring_cq_advance(&ring, count);
     }
 
-    free(pfds);
+    io_uring_queue_exit(&ring);
+    return 0;
 }
+#else
+int uring_loop() {
+    return -ENOSYS;
+}
+#endif
 
 void usage() {
     fprintf(stderr, "Usage: kloak [options]\n");
@@ -351,6 +1243,10 @@ void usage() {
     fprintf(stderr, "  -s startup_timeout: time to wait (milliseconds) before startup. Default 100.\n");
     fprintf(stderr, "  -k csv_string: csv list of rescue key names to exit kloak in case the\n"
             "     keyboard becomes unresponsive. Default is 'KEY_LEFTSHIFT,KEY_RIGHTSHIFT,KEY_ESC'.\n");
+    fprintf(stderr, "  -c socket_path: listen for runtime commands on a UNIX socket\n"
+            "     (delay, keys, pause, resume, add, remove, stats, devices).\n");
+    fprintf(stderr, "  -u: use io_uring for reading and writing events, falls back to poll\n"
+            "     if io_uring is unavailable.\n");
     fprintf(stderr, "  -v: verbose mode\n");
 }
 
@@ -371,10 +1267,14 @@ void banner() {
     }
 
     printf("\n");
+    if (control_fd >= 0)
+        printf("* Control       : %s\n", control_path);
     printf("********************************************************************************\n");
 }
 
 int main(int argc, char **argv) {
+    int err;
+
     if (sodium_init() == -1) {
         panic("sodium_init failed");
     }
@@ -383,7 +1283,7 @@ int main(int argc, char **argv) {
         printf("You are not root! This may not work...\n");
 
     while (1) {
-        int c = getopt_long(argc, argv, "r:d:s:k:vh", long_options, NULL);
+        int c = getopt_long(argc, argv, "r:d:s:k:c:uvh", long_options, NULL);
 
         if (c < 0)
             break;
@@ -409,6 +1309,14 @@ int main(int argc, char **argv) {
             strncpy(rescue_keys_str, optarg, BUFSIZE-1);
             break;
 
+        case 'c':
+            strncpy(control_path, optarg, BUFSIZE-1);
+            break;
+
+        case 'u':
+            use_io_uring = 1;
+            break;
+
         case 'v':
             verbose = 1;
             break;
@@ -442,18 +1350,31 @@ int main(int argc, char **argv) {
     // open the input devices and create the output devices
     init_inputs();
     init_outputs();
+    init_control();
 
     // initialize the event queue
     TAILQ_INIT(&head);
 
     banner();
-    main_loop();
+
+    if (use_io_uring && (err = uring_loop()) < 0) {
+        printf("io_uring is unavailable: %s. Falling back to poll\n", strerror(-err));
+        use_io_uring = 0;
+    }
+    if (!use_io_uring)
+        main_loop();
 
     // close everything
-    for (int i = 0; i < device_count; i++) {
-        libevdev_uinput_destroy(uidevs[i]);
-        libevdev_free(output_devs[i]);
-        close(input_fds[i]);
+    for (int i = device_count - 1; i >= 0; i--) {
+        close_output(i);
+        close_input(i);
+    }
+
+    if (control_client_fd >= 0)
+        close_control_client();
+    if (control_fd >= 0) {
+        close(control_fd);
+        unlink(control_path);
     }
 
     exit(EXIT_SUCCESS);